@@ -32,6 +32,9 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include "easyopts.h"
 
@@ -41,6 +44,8 @@ struct opts
         char *sa0;
         char *sa1;
         int ia2;
+        int ia3;
+        unsigned int ua4;
     } a;
     struct B {
         char *sb0;
@@ -64,6 +69,9 @@ struct opts
 
 #define dim(x) (sizeof(x) / sizeof(x[0]))
 
+static const char *const modes[] = { "fast", "safe", "paranoid" };
+static const char *const traces[] = { "io", "net", "cpu", "mem" };
+
 #ifdef notdef
 void easyopts_addOption(void *gs,
         char shortOption,
@@ -97,24 +105,52 @@ typedef enum easyopts_dataTypeEnum
 int main(int ac, char **av)
 {
     void *sect;
+    void *opt;
+    struct opts options = { 0 };
     easyopts_remainingArgs_t *remainder = NULL;
     easyopts_initProgramOptions(ac, av, "This is the general description of this test program");
-    sect = easyopts_addSection( "Section A", "This is the first test section, it should have 3 options: two strings and an integer", TYPE_PUBLIC     );
+    sect = easyopts_addSection( "Section A", "This is the first test section, it should have 5 options: two strings and three integers", TYPE_PUBLIC     );
         easyopts_addOption(sect, 0, "argA0",  DATATYPE_STRING,     /* "foo", */ REQUIRED_REQUIRED, validateSA0, assignSA0, "Section A, argument 0 description");
         easyopts_addOption(sect, 0, "argA1",  DATATYPE_STRING,     /* "bar", */ REQUIRED_OPTIONAL, validateSA1, assignSA1, "Section A, argument 1 description");
-        easyopts_addOption(sect, 0, "iargA2", DATATYPE_SIGNED_INT, /* 12, */    REQUIRED_OPTIONAL, validateIA2, assignIA2, "Section A, argument 2 description");
+        opt = easyopts_addOption(sect, 0, "iargA2", DATATYPE_SIGNED_INT, /* 12, */    REQUIRED_OPTIONAL, NULL, assignIA2, "Section A, argument 2 description");
+            easyopts_setOptionRange(opt, (easyopts_dataType_t){ .si = 0 }, (easyopts_dataType_t){ .si = 100 });
+        opt = easyopts_addOption(sect, 0, "modeA3", DATATYPE_SIGNED_INT, /* "safe", */ REQUIRED_OPTIONAL, NULL, assignIA3, "Section A, argument 3 description: fast, safe or paranoid");
+            easyopts_setOptionChoices(opt, modes, dim(modes));
+        opt = easyopts_addOption(sect, 0, "traceA4", DATATYPE_UNSIGNED_INT, /* "", */ REQUIRED_OPTIONAL, NULL, assignUA4, "Section A, argument 4 description: comma separated io, net, cpu, mem");
+            easyopts_setOptionFlags(opt, traces, dim(traces));
     sect = easyopts_addSection( "Section B", "This is the second test section, it should have 2 options: two strings and a float",   TYPE_DEPRECATED );
         easyopts_addOption(sect, 0, "argB0",  DATATYPE_STRING,     /* "foo", */ REQUIRED_REQUIRED, validateSB0, assignSB0, "Section B, argument 0 description");
         easyopts_addOption(sect, 0, "argB1",  DATATYPE_STRING,     /* "bar", */ REQUIRED_OPTIONAL, validateSB1, assignSB1, "Section B, argument 1 description");
-        easyopts_addOption(sect, 0, "iargB2", DATATYPE_FLOAT,      /* 3.14, */  REQUIRED_OPTIONAL, validateFB2, assignFB2, "Section B, argument 2 description");
+        opt = easyopts_addOption(sect, 0, "iargB2", DATATYPE_FLOAT,      /* 3.14, */  REQUIRED_OPTIONAL, NULL, assignFB2, "Section B, argument 2 description");
+            easyopts_setOptionRange(opt, (easyopts_dataType_t){ .f = 0.0f }, (easyopts_dataType_t){ .f = 10.0f });
     sect = easyopts_addSection( "Section C", "This is the third test section, it should have 2 options: two doubles and an integer", TYPE_HIDDEN     );
-        easyopts_addOption(sect, 0, "argC0",  DATATYPE_DOUBLE,     /* 1.234, */ REQUIRED_REQUIRED, validateDC0, assignDC0, "Section C, argument 0 description");
-        easyopts_addOption(sect, 0, "argC1",  DATATYPE_DOUBLE,     /* 5.678, */ REQUIRED_OPTIONAL, validateDC1, assignDC1, "Section C, argument 1 description");
-        easyopts_addOption(sect, 0, "iargC2", DATATYPE_SIGNED_INT, /* 12, */    REQUIRED_OPTIONAL, validateIC2, assignIC2, "Section C, argument 2 description");
+        opt = easyopts_addOption(sect, 0, "argC0",  DATATYPE_DOUBLE,     /* 1.234, */ REQUIRED_REQUIRED, NULL, assignDC0, "Section C, argument 0 description");
+            easyopts_setOptionRange(opt, (easyopts_dataType_t){ .d = -1.0 }, (easyopts_dataType_t){ .d = 1.0 });
+        easyopts_addOption(sect, 0, "argC1",  DATATYPE_DOUBLE,     /* 5.678, */ REQUIRED_OPTIONAL, NULL, assignDC1, "Section C, argument 1 description");
+        opt = easyopts_addOption(sect, 0, "iargC2", DATATYPE_SIGNED_INT, /* 12, */    REQUIRED_OPTIONAL, NULL, assignIC2, "Section C, argument 2 description");
+            easyopts_setOptionRange(opt, (easyopts_dataType_t){ .si = 1 }, (easyopts_dataType_t){ .si = 64 });
     sect = easyopts_addSection( "Section D", "This is the fourth test section, it should have 2 options: two doubles and a float",   TYPE_PUBLIC     );
-        easyopts_addOption(sect, 0, "argD0",  DATATYPE_DOUBLE,     /* 1.234, */ REQUIRED_REQUIRED, validateDD0, assignDD0, "Section D, argument 0 description");
-        easyopts_addOption(sect, 0, "argD1",  DATATYPE_DOUBLE,     /* 5.678, */ REQUIRED_OPTIONAL, validateDD1, assignDD1, "Section D, argument 1 description");
-        easyopts_addOption(sect, 0, "iargD2", DATATYPE_FLOAT,      /* 9.012, */ REQUIRED_OPTIONAL, validateFD2, assignFD2, "Section D, argument 2 description");
+        easyopts_addOption(sect, 0, "argD0",  DATATYPE_DOUBLE,     /* 1.234, */ REQUIRED_REQUIRED, NULL, assignDD0, "Section D, argument 0 description");
+        easyopts_addOption(sect, 0, "argD1",  DATATYPE_DOUBLE,     /* 5.678, */ REQUIRED_OPTIONAL, NULL, assignDD1, "Section D, argument 1 description");
+        opt = easyopts_addOption(sect, 0, "iargD2", DATATYPE_FLOAT,      /* 9.012, */ REQUIRED_OPTIONAL, NULL, assignFD2, "Section D, argument 2 description");
+            easyopts_setOptionRange(opt, (easyopts_dataType_t){ .f = 0.0f }, (easyopts_dataType_t){ .f = 100.0f });
+
+    if (getenv("TESTARGS_IMPORT_FD") != NULL) {
+        // We are a child started by the EXPORT / IMPORT section below
+        if (getenv("TESTARGS_IMPORT_MISMATCH") != NULL) {
+            // One more option than the parent registered, so the schema hash won't match
+            easyopts_addOption(sect, 0, "argD3", DATATYPE_DOUBLE, REQUIRED_OPTIONAL, NULL, NULL, "Section D, argument 3 description");
+        }
+        if (easyopts_importValues(atoi(getenv("TESTARGS_IMPORT_FD"))) == 0) {
+            printf("Child %d: imported values from parent\n", (int)getpid());
+        } else {
+            printf("Child %d: schema mismatch, processing the environment instead\n", (int)getpid());
+            easyopts_processEnvironment("TESTARGS", NULL);
+        }
+        easyopts_assignValues(&options);
+        easyopts_free(remainder);
+        return 0;
+    }
 
     printf("========================================\n");
     printf("HELP\n");
@@ -129,6 +165,52 @@ int main(int ac, char **av)
     printf("JSON HELP + JSON\n");
     easyopts_help_hidden_json();
     printf("========================================\n");
+    printf("ENVIRONMENT (e.g. TESTARGS_SECTION_A_ARGA0=foo)\n");
+    if (easyopts_processEnvironment("TESTARGS", NULL) == 0) {
+        easyopts_assignValues(&options);
+    }
+    printf("========================================\n");
+    printf("EXPORT / IMPORT\n");
+    {
+        // Hand the values to two children: one with the same options, one with a different set
+        int fd = easyopts_exportValuesToMemfd();
+        int mismatch;
+        char fdText[16];
+        snprintf(fdText, sizeof(fdText), "%d", fd);
+        for (mismatch = 0; fd >= 0 && mismatch < 2; mismatch++) {
+            pid_t pid;
+            fflush(stdout);
+            pid = fork();
+            if (pid == 0) {
+                setenv("TESTARGS_IMPORT_FD", fdText, 1);
+                if (mismatch) {
+                    setenv("TESTARGS_IMPORT_MISMATCH", "1", 1);
+                }
+                execl("/proc/self/exe", av[0], (char *)NULL);
+                _exit(1);
+            }
+            waitpid(pid, NULL, 0); // only to keep the output apart, children can import at the same time
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    printf("========================================\n");
+    printf("POSITIONAL ARGUMENTS\n");
+    {
+        // Walk argv in batches.  Pass 0 instead of -1 to also read newline separated arguments from stdin.
+        const char *batch[16];
+        int n;
+        void *args = easyopts_openArgIterator(1, -1, '\n', 0);
+        while ((n = easyopts_nextArgs(args, batch, dim(batch))) > 0) {
+            int i;
+            for (i = 0; i < n; i++) {
+                printf("Argument: '%s'\n", batch[i]);
+            }
+        }
+        easyopts_closeArgIterator(args);
+    }
+    printf("========================================\n");
 
     easyopts_free(remainder);
     printf("Version: %s\n", easyopts_getVersion());
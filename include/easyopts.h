@@ -54,6 +54,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 typedef union easyopts_dataType
 {
     signed char sc;
@@ -116,14 +118,25 @@ typedef struct easyopts_remainingArgs
     char **remainingArgs;
 } easyopts_remainingArgs_t;
 
-/* This MUST be called first.  It initializes the internal structure, and
- * binds a description and the command line argc/argv to the program
+/* This MUST be called before anything else but section and option registration.  It initializes the internal
+ * structure, and binds a description and the command line argc/argv to the program
  */
 extern void easyopts_initProgramOptions(int argc, char *argv[], const char *description);
 
 /* Add a section to a program.  Returns a handle to the section, so it can be used to add items.
+ *
+ * Sections and options may be registered from any thread, and before easyopts_initProgramOptions() is called
+ * (e.g. from static constructors of dlopen()ed plugins); registration is lock-free.  Sections are output in
+ * priority order, lowest first.  Within EASYOPTS_PRIORITY_DEFAULT, sections added by the thread that called
+ * easyopts_initProgramOptions(), after calling it, keep their registration order and come first; all other sections
+ * (static constructors, other threads, any other priority) are ordered by name, so help output is stable however
+ * the registering threads are scheduled.  Options within a section keep the order they were added in, so add them
+ * from the thread that added the section.
  */
+#define EASYOPTS_PRIORITY_DEFAULT 0
+
 extern void *easyopts_addSection(const char *name, const char *description, easyopts_type_t type);
+extern void *easyopts_addSectionWithPriority(const char *name, const char *description, easyopts_type_t type, int priority);
 
 /* Add an item to a section
  */
@@ -138,10 +151,31 @@ extern void *easyopts_addSection(const char *name, const char *description, easy
  * is performed).  The options field is provided as a place to fill in the expected value based upon business rules.  For something like --help, assign will print the
  * help message and exit.  Assign() functions are executed in the order of registration.
  */
-extern void easyopts_addOption(void *gs, char shortOption, const char *longOption, easyopts_dataTypeEnum_t type,
+extern void *easyopts_addOption(void *gs, char shortOption, const char *longOption, easyopts_dataTypeEnum_t type,
     /*void *defaultValue,*/ easyopts_required_t isRequired, int (*validate)(easyopts_dataType_t *type),
     void (*assign)(easyopts_dataType_t *type, void *options), const char *description);
 
+/* Declarative constraints on an option (go is the handle returned by easyopts_addOption()).  They are checked while
+ * the value is converted, before validate() is called, so validate() is only needed for real business logic.  An
+ * option can have at most one constraint.  Each returns 0 on failure (wrong data type, bad names), 1 on success.
+ *
+ * easyopts_setOptionRange(): the value must be between minimum and maximum inclusive.  Fill in the union member that
+ * matches the option's type, e.g. (easyopts_dataType_t){ .si = 1 }.  Not valid for strings, or if minimum > maximum.
+ *
+ * easyopts_setOptionChoices(): the value must be one of the choice names, and is converted to the index of that name.
+ * The option must have an integer type that can hold choiceCount - 1.  Lookup is a perfect hash, built in time and
+ * memory linear in choiceCount.
+ *
+ * easyopts_setOptionFlags(): the value is a comma separated list of flag names, and is converted to a bitmask with bit
+ * N set for flags[N].  An empty value sets no flags; an empty name (leading, trailing or doubled comma) is an error.
+ * The option must have an unsigned integer type wide enough for flagCount bits.
+ *
+ * The name arrays are not copied and must stay valid as long as the option exists.
+ */
+extern int easyopts_setOptionRange(void *go, easyopts_dataType_t minimum, easyopts_dataType_t maximum);
+extern int easyopts_setOptionChoices(void *go, const char *const *choices, int choiceCount);
+extern int easyopts_setOptionFlags(void *go, const char *const *flags, int flagCount);
+
 #if 0
 /* Process the command line, returns < 0 on error, 0 on success.
  *
@@ -152,6 +186,74 @@ extern void easyopts_addOption(void *gs, char shortOption, const char *longOptio
 extern int easyopts_process(int argc, char **argv, easyopts_programOptions_t *gpo, easyopts_remainingArgs_t *gra);
 #endif // 0
 
+/* Bind options to environment variables.  Call after all sections and options are registered.
+ *
+ * Each option with a long name is bound to a variable named by mapName(), which writes the name into buffer and
+ * returns 1, or returns 0 to leave the option unbound.  If mapName is NULL the name is PREFIX_SECTION_LONGOPTION,
+ * upper cased, with every character that isn't a letter or digit replaced by '_' (so "argA0" in "Section A" with
+ * prefix "APP" is APP_SECTION_A_ARGA0).  A NULL or empty prefix leaves it off.
+ *
+ * The environment is scanned once; each variable name is hashed and looked up in a table of the bound names.
+ * Values go through the shared conversion step (including any declared constraint) and the validate() callback.
+ * The built-in Common sections (--help, --version, ...) are never bound.  The command line is not parsed yet (see
+ * easyopts_process()), so for now the environment is the only source of values and there is no precedence to apply.
+ *
+ * Returns < 0 if two options map to the same variable name (the second one is left unbound), or if any value
+ * failed conversion or validation (a message is printed to stderr for each), 0 on success.
+ */
+extern int easyopts_processEnvironment(const char *prefix,
+    int (*mapName)(const char *prefix, const char *sectionName, const char *longOption, char *buffer, size_t bufferSize));
+
+/* Call the assign() function of every option that was given a value, in the order of registration.
+ */
+extern void easyopts_assignValues(void *storageObject);
+
+/* Hand resolved option values to child processes, so they don't have to parse and validate them again.
+ *
+ * easyopts_exportValues() writes every option that has a value to fd as a compact binary blob, tagged with a format
+ * version and a hash of the registered sections and options.  easyopts_exportValuesToMemfd() does the same into a new
+ * memfd (not close-on-exec, so it is inherited across exec) positioned at the start, and returns it, or -1 on error.
+ *
+ * In the child, register the same sections and options, then call easyopts_importValues() on the inherited fd.  If fd
+ * is a regular file or memfd, the blob must start at offset 0; it is mapped, and the fd's offset is neither used nor
+ * changed, so any number of children can import from the same fd at once.  Otherwise (a pipe) exactly one blob is
+ * read from the fd.  The values are stored directly, without conversion or validate().  Choice and flag names and
+ * range limits are part of the schema hash.
+ * It returns 0 on success, or < 0 if the blob is unreadable or was written for a different set of options; in that
+ * case nothing is changed, and the child should fall back to processing its command line and environment.  Either
+ * way, follow with easyopts_assignValues().  Imported values keep their original source.
+ */
+extern int easyopts_exportValues(int fd);
+extern int easyopts_exportValuesToMemfd(void);
+extern int easyopts_importValues(int fd);
+
+/* Streaming access to the positional arguments, as an alternative to easyopts_remainingArgs_t for
+ * programs that are fed very large numbers of arguments (e.g. millions of paths via xargs or a pipe).
+ *
+ * easyopts_openArgIterator() returns a handle that first walks argv[firstArg] .. argv[argc - 1] (from
+ * the argc/argv given to easyopts_initProgramOptions()), and then, if fd >= 0, reads delimiter separated
+ * records from fd (use '\n' for line oriented input, '\0' for find -print0 / xargs -0 style input).
+ * A single buffer of bufferSize bytes is allocated and reused for all fd input, so memory use does not
+ * depend on the number of arguments (a bufferSize of 0 selects a 64K buffer).  Empty records are skipped.
+ * The fd is not closed.  Returns NULL if firstArg is negative.
+ *
+ * easyopts_nextArg() returns the next argument, or NULL when there are no more (or on error).
+ * easyopts_nextArgs() fills batch with up to maxArgs arguments and returns how many were filled in, 0 at the
+ * end of input, or < 0 on error.  It returns fewer than maxArgs rather than wait for more input or reuse the
+ * buffer, so processing can overlap with the producer.  Pointers returned by either call are only valid until
+ * the next call on the same handle.
+ *
+ * easyopts_argIteratorError() returns 0 if the iterator ended normally, or the errno value of the failure
+ * (EMSGSIZE if a single record does not fit in bufferSize bytes).  If fd is non-blocking and has no data ready,
+ * easyopts_nextArg() returns NULL, easyopts_nextArgs() returns 0, and easyopts_argIteratorError() returns EAGAIN
+ * until the next call; this is not an error, poll the fd and call again.
+ */
+extern void *easyopts_openArgIterator(int firstArg, int fd, char delimiter, size_t bufferSize);
+extern const char *easyopts_nextArg(void *gi);
+extern int easyopts_nextArgs(void *gi, const char **batch, int maxArgs);
+extern int easyopts_argIteratorError(void *gi);
+extern void easyopts_closeArgIterator(void *gi);
+
 /* When done, free up all the easyopts_programOptions and easyopts_remainingArgs data
  */
 extern void easyopts_free(easyopts_remainingArgs_t *gra);
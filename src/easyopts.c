@@ -31,8 +31,19 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _GNU_SOURCE // memfd_create()
+
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "easyopts.h"
 #include "defs.h"
@@ -42,6 +53,26 @@ typedef struct easyopts_options_list easyopts_options_list_t;
 typedef struct easyopts_section easyopts_section_t;
 typedef struct easyopts_option easyopts_option_t;
 
+/* Where an option's value came from.  Ordered by precedence: a value is only replaced by one from
+ * the same or a higher source.  The environment is the only source until easyopts_process() exists;
+ * a command line source belongs after it.
+ */
+typedef enum easyopts_source
+{
+    SOURCE_NONE = 0,
+    SOURCE_ENVIRONMENT,
+    SOURCE_LIMIT = SOURCE_ENVIRONMENT + 1
+} easyopts_source_t;
+
+/* Declarative constraints checked while converting a value, see easyopts_setOptionRange() and friends */
+typedef enum easyopts_constraint
+{
+    CONSTRAINT_NONE = 0,
+    CONSTRAINT_RANGE,
+    CONSTRAINT_CHOICES,
+    CONSTRAINT_FLAGS
+} easyopts_constraint_t;
+
 struct easyopts_option
 {
     char shortOption;
@@ -52,6 +83,22 @@ struct easyopts_option
     int (*validate)(easyopts_dataType_t *value);
     void (*assign)(easyopts_dataType_t *value, void *storageObject);
     const char *description;
+
+    // Filled in when a value is resolved (from the environment) or imported
+    easyopts_source_t source;
+    int ownsString; // strData was allocated by us and must be freed
+    easyopts_dataType_t value;
+
+    // Filled in by easyopts_setOptionRange(), easyopts_setOptionChoices() and easyopts_setOptionFlags()
+    easyopts_constraint_t constraint;
+    easyopts_dataType_t minimum;
+    easyopts_dataType_t maximum;
+    const char *const *names; // choice or flag names, the index is the id (or bit number)
+    int nameCount;
+    int *nameSlots; // perfect hash table of indexes into names, -1 if empty
+    uint32_t nameMask;
+    uint32_t *nameSeeds; // seed of each bucket of names, for the slot hash
+    uint32_t nameBucketMask;
 };
 
 struct easyopts_section
@@ -59,8 +106,14 @@ struct easyopts_section
     const char *name;
     const char *description;
     easyopts_type_t type;
-    easyopts_options_list_t *firstOption;
+    int builtin; // one of the Common sections added by easyopts_initProgramOptions()
+    int priority;
+    int inRegistrationOrder; // default priority, added after easyopts_initProgramOptions() by the thread that called it
+    unsigned long sequence; // registration order, used for sections that are inRegistrationOrder
+    easyopts_options_list_t *firstOption; // ordered list, built by freezeRegistration()
     easyopts_options_list_t *lastOption;
+    easyopts_options_list_t *pendingOptions; // lock-free stack of options added since the last freeze
+    unsigned long nextOptionSequence;
 };
 
 // Linked list of sections
@@ -75,6 +128,7 @@ struct easyopts_options_list
 {
     easyopts_option_t *object;
     easyopts_options_list_t *next;
+    unsigned long sequence; // registration order within the section
 };
 
 /* This is the program options structure.  We use it internally, it doesn't
@@ -87,9 +141,19 @@ typedef struct easyopts_programOptions
     char **argv;
     const char *description;
 
-    // Filled in by easyopts_addSection
+    // Filled in by easyopts_addSection.  Registration pushes onto pendingSections with a CAS so it can be
+    // called from any thread; freezeRegistration() moves pending sections into the ordered list.
     easyopts_sections_list_t *firstSection; // Pointer to first section, output from here, to preserve ordering
     easyopts_sections_list_t *lastSection; // Pointer to last section, insert here, to preserve ordering
+    easyopts_sections_list_t *pendingSections;
+    unsigned long nextSectionSequence;
+    pthread_t initThread; // the thread that called easyopts_initProgramOptions(), valid once initialized is set
+    int initialized;
+
+    // Filled in by easyopts_importValues(); imported strings point into this buffer
+    char *importBuffer;
+    size_t importSize;
+    int importMapped; // importBuffer is mmap()ed rather than malloc()ed
 
 } easyopts_programOptions_t;
 
@@ -131,22 +195,32 @@ void easyopts_initProgramOptions(int argc, char *argv[], const char *description
     s_commandLineOptions.argc = argc;
     s_commandLineOptions.argv = argv;
     s_commandLineOptions.description = description;
-    s_commandLineOptions.firstSection = NULL;
-    s_commandLineOptions.lastSection = NULL;
+    s_commandLineOptions.initThread = pthread_self();
+    __atomic_store_n(&s_commandLineOptions.initialized, 1, __ATOMIC_RELEASE);
+    // The section lists are not reset here: plugins and static constructors may already have registered sections.
 
-    // And now add the default groups with the help and version options
+    // And now add the default groups with the help and version options, ahead of everything else
     void *sect;
-    sect = easyopts_addSection( "Common", "Provide Common Arguments for help and versioning", TYPE_PUBLIC     );
+    sect = easyopts_addSectionWithPriority( "Common", "Provide Common Arguments for help and versioning", TYPE_PUBLIC, INT_MIN );
+    ((easyopts_section_t *)sect)->builtin = 1;
         easyopts_addOption(sect, 'v', "version",           DATATYPE_STRING,     /* "foo", */ REQUIRED_NONE, NULL, assignVersion, "Print the library's version information");
         easyopts_addOption(sect, 'h', "help",              DATATYPE_STRING,     /* "foo", */ REQUIRED_NONE, NULL, assignHelp, "Print program usage and exit.");
         easyopts_addOption(sect, 0,   "help-json",         DATATYPE_STRING,     /* "foo", */ REQUIRED_NONE, NULL, assignHelpJson, "Print program usage in Json format and exit.");
-    sect = easyopts_addSection( "Common Hidden", "Provide Common Arguments for help and versioning (Hidden)", TYPE_HIDDEN     );
+    sect = easyopts_addSectionWithPriority( "Common Hidden", "Provide Common Arguments for help and versioning (Hidden)", TYPE_HIDDEN, INT_MIN );
+    ((easyopts_section_t *)sect)->builtin = 1;
         easyopts_addOption(sect, 0,   "help-hidden",       DATATYPE_STRING,     /* "foo", */ REQUIRED_NONE, NULL, assignHelpHidden, "Print program usage (including hidden options) and exit.");
         easyopts_addOption(sect, 0,   "help-hidden-json",  DATATYPE_STRING,     /* "foo", */ REQUIRED_NONE, NULL, assignHelpHiddenJson, "Print program usage in Json format (including hidden options) and exit.");
 }
 
+static void freezeRegistration(void);
+
 static void freeOption(easyopts_options_list_t *option)
 {
+    if (option->object->ownsString) {
+        free(option->object->value.strData);
+    }
+    free(option->object->nameSlots);
+    free(option->object->nameSeeds);
     free(option->object); // free option object associated with list item
     free(option); // and free the list item
 }
@@ -167,11 +241,22 @@ void easyopts_free(easyopts_remainingArgs_t *gra)
 {
     /* Free the program options */
     easyopts_sections_list_t *cur;
+    freezeRegistration();
     while(s_commandLineOptions.firstSection != NULL) {
         cur = s_commandLineOptions.firstSection;
         s_commandLineOptions.firstSection = s_commandLineOptions.firstSection->next;
         freeSection(cur);
     }
+    s_commandLineOptions.lastSection = NULL;
+
+    if (s_commandLineOptions.importBuffer != NULL) {
+        if (s_commandLineOptions.importMapped) {
+            munmap(s_commandLineOptions.importBuffer, s_commandLineOptions.importSize);
+        } else {
+            free(s_commandLineOptions.importBuffer);
+        }
+        s_commandLineOptions.importBuffer = NULL; /* protect memory */
+    }
 
     /* And now free the remainingArgs */
     if (gra != NULL) {
@@ -186,34 +271,159 @@ void easyopts_free(easyopts_remainingArgs_t *gra)
     }
 }
 
-/* Add gs to gpo.  We will sort when we are done, so ordering doesn't matter */
-void *easyopts_addSection(const char *name, const char *description, easyopts_type_t type)
+/* Sections are ordered by priority.  Within the default priority, sections added by the thread that called
+ * easyopts_initProgramOptions() (after it was called) keep their registration order and come first.  Every other
+ * section (other priorities, static constructors, plugin loader threads) is ordered by name, so sections that are
+ * registered concurrently come out the same every run.
+ */
+static int compareSections(const easyopts_section_t *a, const easyopts_section_t *b)
+{
+    int c;
+
+    if (a->priority != b->priority) {
+        return (a->priority < b->priority) ? -1 : 1;
+    }
+    if (a->inRegistrationOrder != b->inRegistrationOrder) {
+        return a->inRegistrationOrder ? -1 : 1;
+    }
+    if (!a->inRegistrationOrder) {
+        c = strcmp(a->name, b->name);
+        if (c != 0) {
+            return c;
+        }
+    }
+    return (a->sequence < b->sequence) ? -1 : (a->sequence > b->sequence);
+}
+
+/* Insert into the ordered section list.  Items usually arrive in order, so check the tail first. */
+static void insertSection(easyopts_sections_list_t *item)
+{
+    easyopts_sections_list_t *prev = NULL;
+    easyopts_sections_list_t *cur = s_commandLineOptions.firstSection;
+
+    if (s_commandLineOptions.lastSection == NULL
+            || compareSections(s_commandLineOptions.lastSection->object, item->object) <= 0) {
+        prev = s_commandLineOptions.lastSection;
+        cur = NULL;
+    } else {
+        while (cur != NULL && compareSections(cur->object, item->object) <= 0) {
+            prev = cur;
+            cur = cur->next;
+        }
+    }
+    item->next = cur;
+    if (prev == NULL) {
+        s_commandLineOptions.firstSection = item;
+    } else {
+        prev->next = item;
+    }
+    if (cur == NULL) {
+        s_commandLineOptions.lastSection = item;
+    }
+}
+
+static void insertOption(easyopts_section_t *section, easyopts_options_list_t *item)
+{
+    easyopts_options_list_t *prev = NULL;
+    easyopts_options_list_t *cur = section->firstOption;
+
+    if (section->lastOption == NULL || section->lastOption->sequence <= item->sequence) {
+        prev = section->lastOption;
+        cur = NULL;
+    } else {
+        while (cur != NULL && cur->sequence <= item->sequence) {
+            prev = cur;
+            cur = cur->next;
+        }
+    }
+    item->next = cur;
+    if (prev == NULL) {
+        section->firstOption = item;
+    } else {
+        prev->next = item;
+    }
+    if (cur == NULL) {
+        section->lastOption = item;
+    }
+}
+
+/* Move everything registered since the last call into the ordered lists.  Registration can keep going on other
+ * threads while this runs (it only takes what has been pushed so far), but this must only be called from one
+ * thread at a time; every function that reads the lists calls it first.
+ */
+static void freezeRegistration(void)
+{
+    easyopts_sections_list_t *pending = __atomic_exchange_n(&s_commandLineOptions.pendingSections, NULL, __ATOMIC_ACQUIRE);
+    easyopts_sections_list_t *reversed = NULL;
+    easyopts_sections_list_t *sect;
+
+    // The pending stack is newest first; reverse it so in-order registrations append at the tail
+    while (pending != NULL) {
+        easyopts_sections_list_t *next = pending->next;
+        pending->next = reversed;
+        reversed = pending;
+        pending = next;
+    }
+    while (reversed != NULL) {
+        easyopts_sections_list_t *next = reversed->next;
+        insertSection(reversed);
+        reversed = next;
+    }
+
+    for (sect = s_commandLineOptions.firstSection; sect != NULL; sect = sect->next) {
+        easyopts_options_list_t *option = __atomic_exchange_n(&sect->object->pendingOptions, NULL, __ATOMIC_ACQUIRE);
+        easyopts_options_list_t *reversedOptions = NULL;
+        while (option != NULL) {
+            easyopts_options_list_t *next = option->next;
+            option->next = reversedOptions;
+            reversedOptions = option;
+            option = next;
+        }
+        while (reversedOptions != NULL) {
+            easyopts_options_list_t *next = reversedOptions->next;
+            insertOption(sect->object, reversedOptions);
+            reversedOptions = next;
+        }
+    }
+}
+
+void *easyopts_addSectionWithPriority(const char *name, const char *description, easyopts_type_t type, int priority)
 {
     easyopts_section_t *section = (easyopts_section_t *)malloc(sizeof(easyopts_section_t));
     section->name = name;
     section->description = description;
     section->type = type;
+    section->builtin = 0;
+    section->priority = priority;
+    section->inRegistrationOrder = (priority == EASYOPTS_PRIORITY_DEFAULT)
+        && __atomic_load_n(&s_commandLineOptions.initialized, __ATOMIC_ACQUIRE)
+        && pthread_equal(pthread_self(), s_commandLineOptions.initThread);
+    section->sequence = __atomic_fetch_add(&s_commandLineOptions.nextSectionSequence, 1, __ATOMIC_RELAXED);
     section->firstOption = NULL;
     section->lastOption = NULL;
+    section->pendingOptions = NULL;
+    section->nextOptionSequence = 0;
 
     // Allocate a sections_list item to hold it.
     easyopts_sections_list_t *item = (easyopts_sections_list_t *)malloc(sizeof(easyopts_sections_list_t));
     item->object = section;
-    item->next = NULL;
 
-    // And link it in
-    if (s_commandLineOptions.firstSection == NULL) {
-        s_commandLineOptions.firstSection = item;
+    // And push it on the pending stack; it is put in order by freezeRegistration()
+    item->next = __atomic_load_n(&s_commandLineOptions.pendingSections, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&s_commandLineOptions.pendingSections, &item->next, item,
+            1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // item->next was reloaded with the current head, try again
     }
-    if (s_commandLineOptions.lastSection != NULL) {
-        s_commandLineOptions.lastSection->next = item;
-    }
-    s_commandLineOptions.lastSection = item;
     return (void *)section;
 }
 
+void *easyopts_addSection(const char *name, const char *description, easyopts_type_t type)
+{
+    return easyopts_addSectionWithPriority(name, description, type, EASYOPTS_PRIORITY_DEFAULT);
+}
+
 // Note: gs is a easyopts_section_t, but it is not exposed to the header
-void easyopts_addOption(void *gs, char shortOption, const char *longOption,
+void *easyopts_addOption(void *gs, char shortOption, const char *longOption,
     easyopts_dataTypeEnum_t type, /*void *defaultValue,*/
     easyopts_required_t isRequired,
     int (*validate)(easyopts_dataType_t *type),
@@ -232,19 +442,1227 @@ void easyopts_addOption(void *gs, char shortOption, const char *longOption,
     option->validate = validate;
     option->assign = assign;
     option->description = description;
+    option->source = SOURCE_NONE;
+    option->ownsString = 0;
+    option->value.ull = 0;
+    option->constraint = CONSTRAINT_NONE;
+    option->minimum.ull = 0;
+    option->maximum.ull = 0;
+    option->names = NULL;
+    option->nameCount = 0;
+    option->nameSlots = NULL;
+    option->nameMask = 0;
+    option->nameSeeds = NULL;
+    option->nameBucketMask = 0;
 
     // Create a list node and bind the option data to it
     easyopts_options_list_t *pListItem = (easyopts_options_list_t *)malloc(sizeof(easyopts_options_list_t));
     pListItem->object = option;
+    pListItem->sequence = __atomic_fetch_add(&section->nextOptionSequence, 1, __ATOMIC_RELAXED);
+
+    // And push it on the section's pending stack; it is put in order by freezeRegistration()
+    pListItem->next = __atomic_load_n(&section->pendingOptions, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&section->pendingOptions, &pListItem->next, pListItem,
+            1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // pListItem->next was reloaded with the current head, try again
+    }
+    return (void *)option;
+}
+
+// FNV-1a, with seed mixed into the offset basis
+static uint32_t hashName(const char *name, size_t length, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int integerBits(easyopts_dataTypeEnum_t type)
+{
+    switch(type) {
+        case DATATYPE_SIGNED_CHAR:
+        case DATATYPE_UNSIGNED_CHAR: return CHAR_BIT * sizeof(char);
+        case DATATYPE_SIGNED_SHORT:
+        case DATATYPE_UNSIGNED_SHORT: return CHAR_BIT * sizeof(short);
+        case DATATYPE_SIGNED_INT:
+        case DATATYPE_UNSIGNED_INT: return CHAR_BIT * sizeof(int);
+        case DATATYPE_SIGNED_LONG:
+        case DATATYPE_UNSIGNED_LONG: return CHAR_BIT * sizeof(long);
+        case DATATYPE_SIGNED_LONG_LONG:
+        case DATATYPE_UNSIGNED_LONG_LONG: return CHAR_BIT * sizeof(long long);
+        default: break;
+    }
+    return 0;
+}
+
+static int isSignedType(easyopts_dataTypeEnum_t type)
+{
+    return type == DATATYPE_SIGNED_CHAR || type == DATATYPE_SIGNED_SHORT || type == DATATYPE_SIGNED_INT
+        || type == DATATYPE_SIGNED_LONG || type == DATATYPE_SIGNED_LONG_LONG;
+}
+
+// Largest value an integer type can hold
+static unsigned long long integerMaximum(easyopts_dataTypeEnum_t type)
+{
+    int bits = integerBits(type);
+    if (isSignedType(type)) {
+        bits--;
+    }
+    return (bits >= (int)(CHAR_BIT * sizeof(unsigned long long))) ? ULLONG_MAX : (1ULL << bits) - 1;
+}
+
+// Returns 1 if minimum is greater than maximum, so no value could ever pass
+static int isEmptyRange(easyopts_dataTypeEnum_t type, const easyopts_dataType_t *minimum, const easyopts_dataType_t *maximum)
+{
+#define EMPTY(member) (minimum->member > maximum->member)
+    switch(type) {
+        case DATATYPE_SIGNED_CHAR: return EMPTY(sc);
+        case DATATYPE_UNSIGNED_CHAR: return EMPTY(uc);
+        case DATATYPE_SIGNED_SHORT: return EMPTY(ss);
+        case DATATYPE_UNSIGNED_SHORT: return EMPTY(us);
+        case DATATYPE_SIGNED_INT: return EMPTY(si);
+        case DATATYPE_UNSIGNED_INT: return EMPTY(ui);
+        case DATATYPE_SIGNED_LONG: return EMPTY(sl);
+        case DATATYPE_UNSIGNED_LONG: return EMPTY(ul);
+        case DATATYPE_SIGNED_LONG_LONG: return EMPTY(sll);
+        case DATATYPE_UNSIGNED_LONG_LONG: return EMPTY(ull);
+        case DATATYPE_FLOAT: return EMPTY(f);
+        case DATATYPE_DOUBLE: return EMPTY(d);
+        default: break;
+    }
+    return 0;
+#undef EMPTY
+}
+
+int easyopts_setOptionRange(void *go, easyopts_dataType_t minimum, easyopts_dataType_t maximum)
+{
+    easyopts_option_t *option = (easyopts_option_t *)go;
+
+    if (option->type == DATATYPE_STRING || option->constraint != CONSTRAINT_NONE) {
+        return 0;
+    }
+    if (isEmptyRange(option->type, &minimum, &maximum)) {
+        return 0;
+    }
+    option->constraint = CONSTRAINT_RANGE;
+    option->minimum = minimum;
+    option->maximum = maximum;
+    return 1;
+}
+
+#define NAMES_PER_BUCKET 4
+#define MAX_SEEDS_PER_BUCKET (1 << 16)
+
+typedef struct easyopts_nameBucket
+{
+    uint32_t id;
+    uint32_t first; // index into the bucket members array
+    uint32_t count;
+} easyopts_nameBucket_t;
+
+// Finalizer from MurmurHash3, so the masked low bits depend on every bit of the name hash
+static uint32_t mixHash(uint32_t hash)
+{
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static uint32_t nameBucket(const easyopts_option_t *option, const char *name, size_t length)
+{
+    return mixHash(hashName(name, length, 0)) & option->nameBucketMask;
+}
+
+static uint32_t nameSlot(const easyopts_option_t *option, const char *name, size_t length, uint32_t seed)
+{
+    return mixHash(hashName(name, length, seed)) & option->nameMask;
+}
+
+// Largest buckets first, they are the hardest to place
+static int compareNameBuckets(const void *a, const void *b)
+{
+    const easyopts_nameBucket_t *ba = (const easyopts_nameBucket_t *)a;
+    const easyopts_nameBucket_t *bb = (const easyopts_nameBucket_t *)b;
+    if (ba->count != bb->count) {
+        return (ba->count > bb->count) ? -1 : 1;
+    }
+    return (ba->id < bb->id) ? -1 : (ba->id > bb->id);
+}
 
-    // And connect the node to the end
-    if (section->firstOption == NULL) {
-        section->firstOption = pListItem;
+/* Build a perfect hash table over the names (hash and displace): names are split into small buckets by one hash,
+ * then each bucket, largest first, searches for a seed that puts all of its names in free slots.  The table is at
+ * most 80% full and there is one seed per NAMES_PER_BUCKET names, so memory and build time are linear in nameCount.
+ * Returns 0 on failure (empty, NULL or duplicate names), 1 on success.
+ */
+static int buildNameTable(easyopts_option_t *option, const char *const *names, int nameCount)
+{
+    uint32_t bucketCount = 1;
+    uint32_t tableSize = 1;
+    uint32_t b, j;
+    int i;
+
+    if (names == NULL || nameCount <= 0) {
+        return 0;
+    }
+    for (i = 0; i < nameCount; i++) {
+        if (names[i] == NULL || *names[i] == '\0' || strchr(names[i], ',') != NULL) {
+            return 0;
+        }
+    }
+    while ((uint64_t)bucketCount * NAMES_PER_BUCKET < (uint64_t)nameCount) {
+        bucketCount <<= 1;
+    }
+    while ((uint64_t)tableSize * 4 < (uint64_t)nameCount * 5) {
+        tableSize <<= 1;
+    }
+    option->nameBucketMask = bucketCount - 1;
+
+    // Group the names by bucket
+    easyopts_nameBucket_t *buckets = (easyopts_nameBucket_t *)calloc(bucketCount, sizeof(easyopts_nameBucket_t));
+    uint32_t *bucketOf = (uint32_t *)malloc(nameCount * sizeof(uint32_t));
+    int *members = (int *)malloc(nameCount * sizeof(int));
+    for (i = 0; i < nameCount; i++) {
+        bucketOf[i] = nameBucket(option, names[i], strlen(names[i]));
+        buckets[bucketOf[i]].count++;
+    }
+    for (b = 0, j = 0; b < bucketCount; b++) {
+        buckets[b].id = b;
+        buckets[b].first = j;
+        j += buckets[b].count;
+        buckets[b].count = 0;
+    }
+    for (i = 0; i < nameCount; i++) {
+        easyopts_nameBucket_t *bucket = &buckets[bucketOf[i]];
+        members[bucket->first + bucket->count++] = i;
+    }
+    free(bucketOf);
+
+    // A duplicate always lands in the same bucket as the original, and no seed will ever separate them
+    for (b = 0; b < bucketCount; b++) {
+        uint32_t k;
+        for (j = 0; j < buckets[b].count; j++) {
+            for (k = j + 1; k < buckets[b].count; k++) {
+                if (strcmp(names[members[buckets[b].first + j]], names[members[buckets[b].first + k]]) == 0) {
+                    free(members);
+                    free(buckets);
+                    option->nameBucketMask = 0;
+                    return 0;
+                }
+            }
+        }
+    }
+    qsort(buckets, bucketCount, sizeof(easyopts_nameBucket_t), compareNameBuckets);
+
+    uint32_t *seeds = (uint32_t *)calloc(bucketCount, sizeof(uint32_t));
+    for (;;) {
+        int *slots = (int *)malloc(tableSize * sizeof(int));
+        option->nameMask = tableSize - 1;
+        for (j = 0; j < tableSize; j++) {
+            slots[j] = -1;
+        }
+
+        for (b = 0; b < bucketCount && buckets[b].count > 0; b++) {
+            const int *bucketNames = members + buckets[b].first;
+            uint32_t seed;
+            for (seed = 1; seed <= MAX_SEEDS_PER_BUCKET; seed++) {
+                // Place the names, and take them back out if one lands on a taken slot
+                for (j = 0; j < buckets[b].count; j++) {
+                    const char *name = names[bucketNames[j]];
+                    uint32_t slot = nameSlot(option, name, strlen(name), seed);
+                    if (slots[slot] >= 0) {
+                        break;
+                    }
+                    slots[slot] = bucketNames[j];
+                }
+                if (j == buckets[b].count) {
+                    seeds[buckets[b].id] = seed;
+                    break;
+                }
+                while (j-- > 0) {
+                    const char *name = names[bucketNames[j]];
+                    slots[nameSlot(option, name, strlen(name), seed)] = -1;
+                }
+            }
+            if (seed > MAX_SEEDS_PER_BUCKET) {
+                break;
+            }
+        }
+        if (b == bucketCount || buckets[b].count == 0) {
+            free(members);
+            free(buckets);
+            option->names = names;
+            option->nameCount = nameCount;
+            option->nameSlots = slots;
+            option->nameSeeds = seeds;
+            return 1;
+        }
+
+        // Practically never happens, but give the stuck bucket more room
+        free(slots);
+        tableSize <<= 1;
+    }
+}
+
+int easyopts_setOptionChoices(void *go, const char *const *choices, int choiceCount)
+{
+    easyopts_option_t *option = (easyopts_option_t *)go;
+
+    if (integerBits(option->type) == 0 || option->constraint != CONSTRAINT_NONE) {
+        return 0;
+    }
+    if (choiceCount > 0 && (unsigned long long)(choiceCount - 1) > integerMaximum(option->type)) {
+        return 0; // the largest id wouldn't fit in the option
+    }
+    if (!buildNameTable(option, choices, choiceCount)) {
+        return 0;
+    }
+    option->constraint = CONSTRAINT_CHOICES;
+    return 1;
+}
+
+int easyopts_setOptionFlags(void *go, const char *const *flags, int flagCount)
+{
+    easyopts_option_t *option = (easyopts_option_t *)go;
+
+    if (integerBits(option->type) == 0 || isSignedType(option->type) || option->constraint != CONSTRAINT_NONE) {
+        return 0;
+    }
+    if (flagCount > integerBits(option->type)) {
+        return 0;
+    }
+    if (!buildNameTable(option, flags, flagCount)) {
+        return 0;
+    }
+    option->constraint = CONSTRAINT_FLAGS;
+    return 1;
+}
+
+/* Iterator state for easyopts_openArgIterator().  Records read from fd live in buffer between start and
+ * end; the buffer has one extra byte so a record that exactly fills the buffer can still be terminated.
+ */
+typedef struct easyopts_argIterator
+{
+    int nextArgv; // next index into s_commandLineOptions.argv
+    int fd;
+    char delimiter;
+    int eof;
+    int error;
+    int wouldBlock; // the last read found a non-blocking fd empty, not sticky
+    char *buffer;
+    size_t bufferSize;
+    size_t start; // first unconsumed byte
+    size_t end; // one past the last byte read
+} easyopts_argIterator_t;
+
+#define DEFAULT_ARG_BUFFER_SIZE (64 * 1024)
+
+void *easyopts_openArgIterator(int firstArg, int fd, char delimiter, size_t bufferSize)
+{
+    if (firstArg < 0) {
+        return NULL;
+    }
+    if (bufferSize == 0) {
+        bufferSize = DEFAULT_ARG_BUFFER_SIZE;
+    }
+
+    easyopts_argIterator_t *it = (easyopts_argIterator_t *)malloc(sizeof(easyopts_argIterator_t));
+    it->nextArgv = firstArg;
+    it->fd = fd;
+    it->delimiter = delimiter;
+    it->eof = (fd < 0);
+    it->error = 0;
+    it->wouldBlock = 0;
+    it->buffer = NULL;
+    it->bufferSize = bufferSize;
+    it->start = 0;
+    it->end = 0;
+    if (fd >= 0) {
+        it->buffer = (char *)malloc(bufferSize + 1);
     }
-    if (section->lastOption != NULL) {
-        section->lastOption->next = pListItem;
+    return (void *)it;
+}
+
+/* Return the next record from the fd buffer.  If mayRead is 0, only records already sitting in the
+ * buffer are returned; the buffer is neither refilled nor compacted, so earlier records stay valid.
+ */
+static const char *nextRecord(easyopts_argIterator_t *it, int mayRead)
+{
+    if (mayRead) {
+        it->wouldBlock = 0;
+    }
+    for (;;) {
+        char *record = it->buffer + it->start;
+        char *found = (char *)memchr(record, it->delimiter, it->end - it->start);
+        if (found != NULL) {
+            *found = '\0';
+            it->start = (size_t)(found - it->buffer) + 1;
+            if (*record == '\0') {
+                continue; // skip empty records
+            }
+            return record;
+        }
+        if (it->eof) {
+            // Last record may not be followed by a delimiter
+            if (it->start < it->end) {
+                it->buffer[it->end] = '\0';
+                it->start = it->end;
+                return record;
+            }
+            return NULL;
+        }
+        if (!mayRead) {
+            return NULL;
+        }
+
+        // Need more input: move the partial record to the front to make room
+        if (it->start > 0) {
+            memmove(it->buffer, it->buffer + it->start, it->end - it->start);
+            it->end -= it->start;
+            it->start = 0;
+        }
+        if (it->end == it->bufferSize) {
+            /* The buffer is full with no delimiter.  Read into the spare byte: if input has ended (or the next
+             * byte is the delimiter) the record fits exactly, otherwise it is too long.
+             */
+            ssize_t n = read(it->fd, it->buffer + it->end, 1);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    it->wouldBlock = 1;
+                } else {
+                    it->error = errno;
+                }
+                return NULL;
+            }
+            if (n == 0) {
+                it->eof = 1;
+                continue;
+            }
+            if (it->buffer[it->end] == it->delimiter) {
+                it->end++;
+                continue;
+            }
+            it->error = EMSGSIZE; // record doesn't fit in the buffer
+            return NULL;
+        }
+
+        ssize_t n = read(it->fd, it->buffer + it->end, it->bufferSize - it->end);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                it->wouldBlock = 1; // a non-blocking fd with nothing to read is not an error
+            } else {
+                it->error = errno;
+            }
+            return NULL;
+        }
+        if (n == 0) {
+            it->eof = 1;
+        } else {
+            it->end += (size_t)n;
+        }
     }
-    section->lastOption = pListItem;
+}
+
+const char *easyopts_nextArg(void *gi)
+{
+    easyopts_argIterator_t *it = (easyopts_argIterator_t *)gi;
+
+    if (it->nextArgv < s_commandLineOptions.argc) {
+        return s_commandLineOptions.argv[it->nextArgv++];
+    }
+    if (it->buffer == NULL || it->error) {
+        return NULL;
+    }
+    return nextRecord(it, 1);
+}
+
+int easyopts_nextArgs(void *gi, const char **batch, int maxArgs)
+{
+    easyopts_argIterator_t *it = (easyopts_argIterator_t *)gi;
+    int count = 0;
+
+    while (count < maxArgs && it->nextArgv < s_commandLineOptions.argc) {
+        batch[count++] = s_commandLineOptions.argv[it->nextArgv++];
+    }
+    if (it->buffer == NULL || it->error) {
+        return (count == 0 && it->error) ? -1 : count;
+    }
+
+    // Only the first record of a batch may block or reuse the buffer
+    while (count < maxArgs) {
+        const char *record = nextRecord(it, count == 0);
+        if (record == NULL) {
+            break;
+        }
+        batch[count++] = record;
+    }
+    if (count == 0 && it->error) {
+        return -1;
+    }
+    return count;
+}
+
+int easyopts_argIteratorError(void *gi)
+{
+    easyopts_argIterator_t *it = (easyopts_argIterator_t *)gi;
+    if (it->error == 0 && it->wouldBlock) {
+        return EAGAIN;
+    }
+    return it->error;
+}
+
+void easyopts_closeArgIterator(void *gi)
+{
+    easyopts_argIterator_t *it = (easyopts_argIterator_t *)gi;
+    if (it != NULL) {
+        free(it->buffer);
+        it->buffer = NULL; /* protect memory */
+        free(it);
+    }
+}
+
+/* Look up a choice or flag name.  The table is a perfect hash, so this is two hashes and one compare.
+ * Returns the index of the name, or -1.
+ */
+static int lookupName(const easyopts_option_t *option, const char *text, size_t length)
+{
+    uint32_t seed = option->nameSeeds[nameBucket(option, text, length)];
+    int index = option->nameSlots[nameSlot(option, text, length, seed)];
+    if (index >= 0 && strncmp(option->names[index], text, length) == 0 && option->names[index][length] == '\0') {
+        return index;
+    }
+    return -1;
+}
+
+// Check the value against the option's range.  Returns 0 if it is outside, 1 otherwise.
+static int checkRange(const easyopts_option_t *option, const easyopts_dataType_t *value)
+{
+#define IN_RANGE(member) (value->member >= option->minimum.member && value->member <= option->maximum.member)
+    if (option->constraint != CONSTRAINT_RANGE) {
+        return 1;
+    }
+    switch(option->type) {
+        case DATATYPE_SIGNED_CHAR: return IN_RANGE(sc);
+        case DATATYPE_UNSIGNED_CHAR: return IN_RANGE(uc);
+        case DATATYPE_SIGNED_SHORT: return IN_RANGE(ss);
+        case DATATYPE_UNSIGNED_SHORT: return IN_RANGE(us);
+        case DATATYPE_SIGNED_INT: return IN_RANGE(si);
+        case DATATYPE_UNSIGNED_INT: return IN_RANGE(ui);
+        case DATATYPE_SIGNED_LONG: return IN_RANGE(sl);
+        case DATATYPE_UNSIGNED_LONG: return IN_RANGE(ul);
+        case DATATYPE_SIGNED_LONG_LONG: return IN_RANGE(sll);
+        case DATATYPE_UNSIGNED_LONG_LONG: return IN_RANGE(ull);
+        case DATATYPE_FLOAT: return IN_RANGE(f);
+        case DATATYPE_DOUBLE: return IN_RANGE(d);
+        default: break;
+    }
+    return 1;
+#undef IN_RANGE
+}
+
+/* Convert text to the option's data type, applying any declared range, choice or flag constraint.
+ * This is the single conversion step shared by every source of option values.  Returns 0 on failure,
+ * 1 on success; on success a string value is a copy owned by the caller.
+ */
+static int convertValue(const easyopts_option_t *option, const char *text, easyopts_dataType_t *value)
+{
+    char *end = NULL;
+    long long sll = 0;
+    unsigned long long ull = 0;
+
+    errno = 0;
+    if (option->constraint == CONSTRAINT_CHOICES) {
+        int index = lookupName(option, text, strlen(text));
+        if (index < 0) {
+            return 0;
+        }
+        sll = index;
+        ull = (unsigned long long)index;
+    } else if (option->constraint == CONSTRAINT_FLAGS) {
+        // Comma separated names, each one sets its bit; an empty name (",io", "io,,net", "io,") is an error
+        const char *p = text;
+        while (*p != '\0') {
+            size_t length = strcspn(p, ",");
+            int index = lookupName(option, p, length);
+            if (index < 0) {
+                return 0;
+            }
+            ull |= 1ULL << index;
+            p += length;
+            if (*p == ',' && *++p == '\0') {
+                return 0;
+            }
+        }
+    } else {
+        switch(option->type) {
+            case DATATYPE_SIGNED_CHAR:
+            case DATATYPE_SIGNED_SHORT:
+            case DATATYPE_SIGNED_INT:
+            case DATATYPE_SIGNED_LONG:
+            case DATATYPE_SIGNED_LONG_LONG:
+                sll = strtoll(text, &end, 0);
+                break;
+            case DATATYPE_UNSIGNED_CHAR:
+            case DATATYPE_UNSIGNED_SHORT:
+            case DATATYPE_UNSIGNED_INT:
+            case DATATYPE_UNSIGNED_LONG:
+            case DATATYPE_UNSIGNED_LONG_LONG:
+                if (strchr(text, '-') != NULL) {
+                    return 0; // strtoull() silently negates
+                }
+                ull = strtoull(text, &end, 0);
+                break;
+            case DATATYPE_FLOAT:
+                value->f = strtof(text, &end);
+                break;
+            case DATATYPE_DOUBLE:
+                value->d = strtod(text, &end);
+                break;
+            case DATATYPE_STRING:
+                value->strData = strdup(text);
+                return 1;
+            default:
+                return 0;
+        }
+        if (end == text || *end != '\0' || errno == ERANGE) {
+            return 0;
+        }
+    }
+
+    switch(option->type) {
+        case DATATYPE_SIGNED_CHAR:
+            if (sll < SCHAR_MIN || sll > SCHAR_MAX) return 0;
+            value->sc = (signed char)sll;
+            break;
+        case DATATYPE_SIGNED_SHORT:
+            if (sll < SHRT_MIN || sll > SHRT_MAX) return 0;
+            value->ss = (signed short)sll;
+            break;
+        case DATATYPE_SIGNED_INT:
+            if (sll < INT_MIN || sll > INT_MAX) return 0;
+            value->si = (signed int)sll;
+            break;
+        case DATATYPE_SIGNED_LONG:
+            if (sll < LONG_MIN || sll > LONG_MAX) return 0;
+            value->sl = (signed long)sll;
+            break;
+        case DATATYPE_SIGNED_LONG_LONG:
+            value->sll = sll;
+            break;
+        case DATATYPE_UNSIGNED_CHAR:
+            if (ull > UCHAR_MAX) return 0;
+            value->uc = (unsigned char)ull;
+            break;
+        case DATATYPE_UNSIGNED_SHORT:
+            if (ull > USHRT_MAX) return 0;
+            value->us = (unsigned short)ull;
+            break;
+        case DATATYPE_UNSIGNED_INT:
+            if (ull > UINT_MAX) return 0;
+            value->ui = (unsigned int)ull;
+            break;
+        case DATATYPE_UNSIGNED_LONG:
+            if (ull > ULONG_MAX) return 0;
+            value->ul = (unsigned long)ull;
+            break;
+        case DATATYPE_UNSIGNED_LONG_LONG:
+            value->ull = ull;
+            break;
+        default:
+            break;
+    }
+    return checkRange(option, value);
+}
+
+/* Convert, validate and store a value for an option.  Returns 0 on failure, 1 on success (including
+ * when the value is ignored because the option already has one from a higher precedence source).
+ */
+static int resolveValue(easyopts_option_t *option, const char *text, easyopts_source_t source)
+{
+    easyopts_dataType_t value;
+
+    if (option->source > source) {
+        return 1;
+    }
+    value.ull = 0;
+    if (!convertValue(option, text, &value)) {
+        return 0;
+    }
+    if (option->validate != NULL && !option->validate(&value)) {
+        if (option->type == DATATYPE_STRING) {
+            free(value.strData);
+        }
+        return 0;
+    }
+
+    if (option->ownsString) {
+        free(option->value.strData);
+    }
+    option->value = value;
+    option->ownsString = (option->type == DATATYPE_STRING);
+    option->source = source;
+    return 1;
+}
+
+#define ENV_NAME_SIZE 256
+
+/* PREFIX_SECTION_LONGOPTION, upper cased, with anything that isn't alphanumeric turned into '_' */
+static int defaultEnvironmentName(const char *prefix, const char *sectionName, const char *longOption,
+    char *buffer, size_t bufferSize)
+{
+    int n;
+    char *p;
+
+    if (longOption == NULL) {
+        return 0;
+    }
+    if (prefix != NULL && *prefix != '\0') {
+        n = snprintf(buffer, bufferSize, "%s_%s_%s", prefix, sectionName, longOption);
+    } else {
+        n = snprintf(buffer, bufferSize, "%s_%s", sectionName, longOption);
+    }
+    if (n < 0 || (size_t)n >= bufferSize) {
+        return 0;
+    }
+    for (p = buffer; *p != '\0'; p++) {
+        *p = isalnum((unsigned char)*p) ? (char)toupper((unsigned char)*p) : '_';
+    }
+    return 1;
+}
+
+typedef struct easyopts_envBinding
+{
+    char *name;
+    size_t length;
+    uint32_t hash;
+    easyopts_option_t *option;
+} easyopts_envBinding_t;
+
+extern char **environ;
+
+int easyopts_processEnvironment(const char *prefix,
+    int (*mapName)(const char *prefix, const char *sectionName, const char *longOption, char *buffer, size_t bufferSize))
+{
+    easyopts_sections_list_t *sect;
+    easyopts_options_list_t *option;
+    size_t optionCount = 0;
+    size_t tableSize = 1;
+    size_t mask;
+    size_t i;
+    char **env;
+    char name[ENV_NAME_SIZE];
+    int errors = 0;
+
+    if (mapName == NULL) {
+        mapName = defaultEnvironmentName;
+    }
+    freezeRegistration();
+
+    // Build an open addressed hash table of the mapped names, at most half full
+    for (sect = s_commandLineOptions.firstSection; sect != NULL; sect = sect->next) {
+        for (option = sect->object->firstOption; option != NULL; option = option->next) {
+            optionCount++;
+        }
+    }
+    while (tableSize < optionCount * 2) {
+        tableSize <<= 1;
+    }
+    mask = tableSize - 1;
+    easyopts_envBinding_t *table = (easyopts_envBinding_t *)calloc(tableSize, sizeof(easyopts_envBinding_t));
+
+    for (sect = s_commandLineOptions.firstSection; sect != NULL; sect = sect->next) {
+        for (option = sect->object->firstOption; option != NULL; option = option->next) {
+            easyopts_option_t *o = option->object;
+            // --help and friends are actions, a stray variable must not be able to trigger them
+            if (sect->object->builtin) {
+                continue;
+            }
+            if (!mapName(prefix, sect->object->name, o->longOption, name, sizeof(name))) {
+                continue;
+            }
+            size_t length = strlen(name);
+            uint32_t hash = hashName(name, length, 0);
+            for (i = hash & mask; table[i].name != NULL; i = (i + 1) & mask) {
+                if (table[i].hash == hash && table[i].length == length && memcmp(table[i].name, name, length) == 0) {
+                    break;
+                }
+            }
+            if (table[i].name != NULL) {
+                fprintf(stderr, "%s: environment variable %s is bound to more than one option\n",
+                    s_commandLineOptions.argv[0], name);
+                errors++;
+                continue;
+            }
+            table[i].name = strdup(name);
+            table[i].length = length;
+            table[i].hash = hash;
+            table[i].option = o;
+        }
+    }
+
+    // And look up every environment variable exactly once
+    for (env = environ; env != NULL && *env != NULL; env++) {
+        const char *var = *env;
+        const char *equals = strchr(var, '=');
+        if (equals == NULL) {
+            continue;
+        }
+        size_t length = (size_t)(equals - var);
+        uint32_t hash = hashName(var, length, 0);
+        for (i = hash & mask; table[i].name != NULL; i = (i + 1) & mask) {
+            if (table[i].hash == hash && table[i].length == length && memcmp(table[i].name, var, length) == 0) {
+                if (!resolveValue(table[i].option, equals + 1, SOURCE_ENVIRONMENT)) {
+                    fprintf(stderr, "%s: invalid value '%s' for %s\n", s_commandLineOptions.argv[0], equals + 1, table[i].name);
+                    errors++;
+                }
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < tableSize; i++) {
+        free(table[i].name);
+    }
+    free(table);
+    return errors ? -1 : 0;
+}
+
+void easyopts_assignValues(void *storageObject)
+{
+    easyopts_sections_list_t *sect;
+    easyopts_options_list_t *option;
+
+    freezeRegistration();
+
+    for (sect = s_commandLineOptions.firstSection; sect != NULL; sect = sect->next) {
+        for (option = sect->object->firstOption; option != NULL; option = option->next) {
+            easyopts_option_t *o = option->object;
+            if (o->source != SOURCE_NONE && o->assign != NULL) {
+                o->assign(&o->value, storageObject);
+            }
+        }
+    }
+}
+
+/* Serialized values, see easyopts_exportValues().  All fields are native endian, since the blob is only
+ * meant to be passed from a process to its children.  The header is followed by valueCount entries;
+ * a string entry's payload is the string length, and the string (with its terminator) follows, padded
+ * to a multiple of 8 bytes.
+ */
+#define EXPORT_MAGIC "EZOV"
+#define EXPORT_VERSION 1
+
+typedef struct easyopts_exportHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t schemaHash;
+    uint64_t totalSize;
+    uint32_t valueCount;
+    uint32_t reserved;
+} easyopts_exportHeader_t;
+
+typedef struct easyopts_exportEntry
+{
+    uint64_t optionKey; // see optionKey(), independent of where the option sits in the lists
+    uint32_t source;
+    uint32_t reserved;
+    uint64_t payload;
+} easyopts_exportEntry_t;
+
+#define EXPORT_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+// 64 bit FNV-1a, continuing from hash
+static uint64_t hashSchemaBytes(uint64_t hash, const void *data, size_t length)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static uint64_t hashSchemaString(uint64_t hash, const char *text)
+{
+    if (text == NULL) {
+        text = "";
+    }
+    return hashSchemaBytes(hash, text, strlen(text) + 1);
+}
+
+// Size of the union member used by a data type; the rest of the union's bytes are unspecified
+static size_t dataTypeSize(easyopts_dataTypeEnum_t type)
+{
+    switch(type) {
+        case DATATYPE_FLOAT: return sizeof(float);
+        case DATATYPE_DOUBLE: return sizeof(double);
+        case DATATYPE_STRING: return sizeof(char *);
+        default: break;
+    }
+    return (size_t)integerBits(type) / CHAR_BIT;
+}
+
+// Identify an option by its section name and its long (or short) option name
+static uint64_t optionKey(const easyopts_section_t *section, const easyopts_option_t *option)
+{
+    uint64_t hash = hashSchemaString(14695981039346656037ull, section->name);
+    hash = hashSchemaString(hash, option->longOption);
+    return hashSchemaBytes(hash, &option->shortOption, sizeof(option->shortOption));
+}
+
+/* Hash everything that determines how an exported blob maps onto the registered options.  Section hashes are
+ * summed, so the result doesn't depend on the order sections were registered in.
+ */
+static uint64_t schemaHash(void)
+{
+    easyopts_sections_list_t *sect;
+    easyopts_options_list_t *option;
+    uint32_t size = sizeof(easyopts_dataType_t);
+    uint64_t hash = hashSchemaBytes(14695981039346656037ull, &size, sizeof(size));
+
+    for (sect = s_commandLineOptions.firstSection; sect != NULL; sect = sect->next) {
+        uint64_t sectionHash = hashSchemaString(14695981039346656037ull, sect->object->name);
+        for (option = sect->object->firstOption; option != NULL; option = option->next) {
+            easyopts_option_t *o = option->object;
+            int32_t fields[4] = { o->shortOption, o->type, o->constraint, o->nameCount };
+            int i;
+            sectionHash = hashSchemaString(sectionHash, o->longOption);
+            sectionHash = hashSchemaBytes(sectionHash, fields, sizeof(fields));
+            // The constraint details decide what an imported value means (choice ids, flag bits) or allows
+            for (i = 0; i < o->nameCount; i++) {
+                sectionHash = hashSchemaString(sectionHash, o->names[i]);
+            }
+            if (o->constraint == CONSTRAINT_RANGE) {
+                sectionHash = hashSchemaBytes(sectionHash, &o->minimum, dataTypeSize(o->type));
+                sectionHash = hashSchemaBytes(sectionHash, &o->maximum, dataTypeSize(o->type));
+            }
+        }
+        hash += sectionHash;
+    }
+    return hash;
+}
+
+static int writeAll(int fd, const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+int easyopts_exportValues(int fd)
+{
+    easyopts_sections_list_t *sect;
+    easyopts_options_list_t *option;
+    easyopts_exportHeader_t header;
+    char *blob;
+    char *p;
+    int result;
+
+    freezeRegistration();
+
+    // Size it first, so the whole blob goes out in one write
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EXPORT_MAGIC, sizeof(header.magic));
+    header.version = EXPORT_VERSION;
+    header.schemaHash = schemaHash();
+    header.totalSize = sizeof(header);
+    for (sect = s_commandLineOptions.firstSection; sect != NULL; sect = sect->next) {
+        for (option = sect->object->firstOption; option != NULL; option = option->next) {
+            easyopts_option_t *o = option->object;
+            if (o->source == SOURCE_NONE) {
+                continue;
+            }
+            header.valueCount++;
+            header.totalSize += sizeof(easyopts_exportEntry_t);
+            if (o->type == DATATYPE_STRING) {
+                header.totalSize += EXPORT_ALIGN(strlen(o->value.strData) + 1);
+            }
+        }
+    }
+
+    blob = (char *)calloc(1, header.totalSize);
+    memcpy(blob, &header, sizeof(header));
+    p = blob + sizeof(header);
+    for (sect = s_commandLineOptions.firstSection; sect != NULL; sect = sect->next) {
+        for (option = sect->object->firstOption; option != NULL; option = option->next) {
+            easyopts_option_t *o = option->object;
+            easyopts_exportEntry_t entry;
+            if (o->source == SOURCE_NONE) {
+                continue;
+            }
+            entry.optionKey = optionKey(sect->object, o);
+            entry.source = o->source;
+            entry.reserved = 0;
+            entry.payload = 0;
+            if (o->type == DATATYPE_STRING) {
+                entry.payload = strlen(o->value.strData);
+            } else {
+                memcpy(&entry.payload, &o->value, sizeof(o->value));
+            }
+            memcpy(p, &entry, sizeof(entry));
+            p += sizeof(entry);
+            if (o->type == DATATYPE_STRING) {
+                memcpy(p, o->value.strData, entry.payload + 1);
+                p += EXPORT_ALIGN(entry.payload + 1);
+            }
+        }
+    }
+
+    result = writeAll(fd, blob, header.totalSize);
+    free(blob);
+    return result;
+}
+
+int easyopts_exportValuesToMemfd(void)
+{
+    // Not close-on-exec: the point is for exec()ed children to inherit it
+    int fd = memfd_create("easyopts", 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (easyopts_exportValues(fd) < 0 || lseek(fd, 0, SEEK_SET) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Read exactly length bytes, at offset with pread() if offset >= 0, otherwise from the current position.
+ * Returns 0 on success, -1 on error or if the data ends early.
+ */
+static int readAll(int fd, char *data, size_t length, off_t offset)
+{
+    while (length > 0) {
+        ssize_t n = (offset >= 0) ? pread(fd, data, length, offset) : read(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            return -1;
+        }
+        data += n;
+        length -= (size_t)n;
+        if (offset >= 0) {
+            offset += n;
+        }
+    }
+    return 0;
+}
+
+/* Get the blob into memory.  A regular file (or memfd) holds the blob at offset 0 and is mapped, or read with
+ * pread(), so its file offset, which is shared with every process the fd was inherited by, is neither used nor
+ * changed.  Anything else (a pipe) is read from its current position: the header, then exactly the rest of the
+ * blob, so it doesn't wait for an EOF that an inherited write end may never send, or consume what follows.
+ */
+static char *loadImport(int fd, size_t *size, int *mapped)
+{
+    easyopts_exportHeader_t header;
+    struct stat st;
+    off_t offset = -1;
+    char *buffer;
+
+    if (fstat(fd, &st) != 0) {
+        return NULL;
+    }
+    if (S_ISREG(st.st_mode)) {
+        if ((size_t)st.st_size < sizeof(header)) {
+            return NULL;
+        }
+        // Private and writable, so imported strings can be modified like any other strData
+        buffer = (char *)mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (buffer != MAP_FAILED) {
+            *size = (size_t)st.st_size;
+            *mapped = 1;
+            return buffer;
+        }
+        offset = 0;
+    }
+
+    if (readAll(fd, (char *)&header, sizeof(header), offset) < 0) {
+        return NULL;
+    }
+    if (memcmp(header.magic, EXPORT_MAGIC, sizeof(header.magic)) != 0 || header.totalSize < sizeof(header)
+            || header.totalSize > SIZE_MAX) {
+        return NULL;
+    }
+    buffer = (char *)malloc((size_t)header.totalSize);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    memcpy(buffer, &header, sizeof(header));
+    if (readAll(fd, buffer + sizeof(header), (size_t)header.totalSize - sizeof(header),
+            (offset >= 0) ? offset + (off_t)sizeof(header) : -1) < 0) {
+        free(buffer);
+        return NULL;
+    }
+    *size = (size_t)header.totalSize;
+    *mapped = 0;
+    return buffer;
+}
+
+static void releaseImport(char *buffer, size_t size, int mapped)
+{
+    if (mapped) {
+        munmap(buffer, size);
+    } else {
+        free(buffer);
+    }
+}
+
+typedef struct easyopts_importKey
+{
+    uint64_t key;
+    easyopts_option_t *option;
+} easyopts_importKey_t;
+
+static int compareImportKeys(const void *a, const void *b)
+{
+    uint64_t ka = ((const easyopts_importKey_t *)a)->key;
+    uint64_t kb = ((const easyopts_importKey_t *)b)->key;
+    return (ka < kb) ? -1 : (ka > kb);
+}
+
+int easyopts_importValues(int fd)
+{
+    easyopts_sections_list_t *sect;
+    easyopts_options_list_t *option;
+    easyopts_importKey_t *options;
+    easyopts_exportHeader_t header;
+    uint32_t optionCount = 0;
+    uint32_t i;
+    size_t size = 0;
+    size_t offset;
+    int mapped = 0;
+    int pass;
+    char *buffer;
+
+    if (s_commandLineOptions.importBuffer != NULL) {
+        return -1; // only one import per program
+    }
+    freezeRegistration();
+
+    buffer = loadImport(fd, &size, &mapped);
+    if (buffer == NULL) {
+        return -1;
+    }
+    if (size < sizeof(header)) {
+        releaseImport(buffer, size, mapped);
+        return -1;
+    }
+    memcpy(&header, buffer, sizeof(header));
+    if (memcmp(header.magic, EXPORT_MAGIC, sizeof(header.magic)) != 0 || header.version != EXPORT_VERSION
+            || header.schemaHash != schemaHash() || header.totalSize > size) {
+        releaseImport(buffer, size, mapped);
+        return -1;
+    }
+
+    for (sect = s_commandLineOptions.firstSection; sect != NULL; sect = sect->next) {
+        for (option = sect->object->firstOption; option != NULL; option = option->next) {
+            optionCount++;
+        }
+    }
+    // Sort the options by key, so each entry is found with a binary search
+    options = (easyopts_importKey_t *)malloc((optionCount + 1) * sizeof(easyopts_importKey_t));
+    i = 0;
+    for (sect = s_commandLineOptions.firstSection; sect != NULL; sect = sect->next) {
+        for (option = sect->object->firstOption; option != NULL; option = option->next) {
+            options[i].key = optionKey(sect->object, option->object);
+            options[i].option = option->object;
+            i++;
+        }
+    }
+    qsort(options, optionCount, sizeof(easyopts_importKey_t), compareImportKeys);
+    for (i = 1; i < optionCount; i++) {
+        if (options[i].key == options[i - 1].key) {
+            // Two options can't be told apart, so don't guess
+            free(options);
+            releaseImport(buffer, size, mapped);
+            return -1;
+        }
+    }
+
+    // Check every entry before storing any, so a bad buffer leaves the options untouched
+    for (pass = 0; pass < 2; pass++) {
+        offset = sizeof(header);
+        for (i = 0; i < header.valueCount; i++) {
+            easyopts_exportEntry_t entry;
+            easyopts_importKey_t probe;
+            easyopts_importKey_t *found;
+            easyopts_option_t *o;
+            if (offset + sizeof(entry) > header.totalSize) {
+                break;
+            }
+            memcpy(&entry, buffer + offset, sizeof(entry));
+            offset += sizeof(entry);
+            if (entry.source == SOURCE_NONE || entry.source >= SOURCE_LIMIT) {
+                break;
+            }
+            probe.key = entry.optionKey;
+            found = (easyopts_importKey_t *)bsearch(&probe, options, optionCount,
+                sizeof(easyopts_importKey_t), compareImportKeys);
+            if (found == NULL) {
+                break;
+            }
+            o = found->option;
+            if (o->type == DATATYPE_STRING) {
+                if (entry.payload >= header.totalSize - offset || buffer[offset + entry.payload] != '\0') {
+                    break;
+                }
+            }
+            if (pass == 1) {
+                if (o->ownsString) {
+                    free(o->value.strData);
+                }
+                o->ownsString = 0;
+                o->source = (easyopts_source_t)entry.source;
+                if (o->type == DATATYPE_STRING) {
+                    o->value.strData = buffer + offset;
+                } else {
+                    memcpy(&o->value, &entry.payload, sizeof(o->value));
+                }
+            }
+            if (o->type == DATATYPE_STRING) {
+                offset += EXPORT_ALIGN(entry.payload + 1);
+            }
+        }
+        if (i != header.valueCount) {
+            free(options);
+            releaseImport(buffer, size, mapped);
+            return -1;
+        }
+    }
+
+    free(options);
+    s_commandLineOptions.importBuffer = buffer;
+    s_commandLineOptions.importSize = size;
+    s_commandLineOptions.importMapped = mapped;
+    return 0;
 }
 
 #if 0
@@ -289,6 +1707,8 @@ static const char *easyopts_print_option_type(easyopts_dataTypeEnum_t t)
 /* TODO: Format based upon terminal size */
 static void _easyopts_help(int showHidden)
 {
+    freezeRegistration();
+
     // TODO: Deal with --version and --help (for both visible and hidden
     easyopts_sections_list_t *sections = s_commandLineOptions.firstSection;
     easyopts_sections_list_t *sect;